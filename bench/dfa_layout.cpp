@@ -0,0 +1,396 @@
+// Measures whether laying out dfa_cpp states by a visit profile helps lexing throughput.
+//
+// Usage: dfa_layout_benchmark [source files...]
+//
+// The corpus (by default the library's own sources) is repeated to at least 16 MB. Each layout walks the whole corpus
+// the way internal::read_token does. Reported per layout: the best MB/s of several runs, and the L1D and last level
+// cache read misses per KB of input when hardware counters are available (Linux perf_event_open).
+//
+// Layouts:
+//   pointer, build order    dfa_cpp as constructed: one heap allocation (1 KiB) per state.
+//   pointer, profile order  The same states copied into one contiguous block, hottest first.
+//   compact, build order    128 x uint16_t next-state indices per state (256 bytes), construction order.
+//   compact, profile order  The compact table with states renumbered hottest first.
+//
+// The profile is recorded on the same corpus, so the profile-ordered numbers are a best case.
+
+#include <tokenize/tokenize.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+struct cache_counter
+{
+    int m_fd = -1;
+
+    cache_counter(unsigned long long cache)
+    {
+#if defined(__linux__)
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+    }
+
+    ~cache_counter()
+    {
+#if defined(__linux__)
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+#endif
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Returns -1 when the counter is not available.
+    long long stop()
+    {
+#if defined(__linux__)
+        long long count = 0;
+
+        if (m_fd >= 0 && ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(m_fd, &count, sizeof(count)) == sizeof(count))
+        {
+            return count;
+        }
+#endif
+        return -1;
+    }
+};
+
+#if defined(__linux__)
+const unsigned long long l1d_cache = PERF_COUNT_HW_CACHE_L1D;
+const unsigned long long last_level_cache = PERF_COUNT_HW_CACHE_LL;
+#else
+const unsigned long long l1d_cache = 0;
+const unsigned long long last_level_cache = 0;
+#endif
+
+std::vector<size_t> state_indices(const tokenize::dfa_base& dfa, std::unordered_map<const tokenize::dfa_state*, size_t>& out_index)
+{
+    for (size_t i = 0; i < dfa.states.size(); ++i)
+    {
+        out_index[dfa.states[i]] = i;
+    }
+
+    std::vector<size_t> order(dfa.states.size());
+    std::iota(order.begin(), order.end(), 0);
+    return order;
+}
+
+// Counts the states visited while tokenizing the corpus, replaying only the accepted transitions.
+std::vector<uint64_t> record_profile(const tokenize::dfa_base& dfa, const std::string& corpus)
+{
+    std::unordered_map<const tokenize::dfa_state*, size_t> index;
+    state_indices(dfa, index);
+    std::vector<uint64_t> visits(dfa.states.size(), 0);
+    const char* stream = corpus.c_str();
+
+    while (*stream != '\0')
+    {
+        tokenize::token language_token;
+        tokenize::internal::read_trimmed_token(stream, dfa, language_token);
+        const tokenize::dfa_state* state = dfa.root;
+        ++visits[index[state]];
+
+        for (size_t i = 0; i < language_token.m_length; ++i)
+        {
+            state = state->m_edge[static_cast<unsigned char>(stream[i])];
+            ++visits[index[state]];
+        }
+
+        stream += std::max<size_t>(1, language_token.m_length);
+    }
+
+    return visits;
+}
+
+// Root first, then by descending visit count.
+std::vector<size_t> profile_order(const tokenize::dfa_base& dfa, const std::vector<uint64_t>& visits)
+{
+    std::unordered_map<const tokenize::dfa_state*, size_t> index;
+    std::vector<size_t> order = state_indices(dfa, index);
+    size_t root = index[dfa.root];
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        {
+            if ((a == root) != (b == root))
+            {
+                return a == root;
+            }
+
+            return visits[a] > visits[b];
+        });
+    return order;
+}
+
+struct packed_dfa
+{
+    std::unique_ptr<tokenize::dfa_state[]> m_states;
+    const tokenize::dfa_state* m_root = nullptr;
+
+    packed_dfa(const tokenize::dfa_base& dfa, const std::vector<size_t>& order)
+        : m_states(new tokenize::dfa_state[order.size()]())
+    {
+        std::unordered_map<const tokenize::dfa_state*, tokenize::dfa_state*> location;
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            location[dfa.states[order[i]]] = &m_states[i];
+        }
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const tokenize::dfa_state* state = dfa.states[order[i]];
+            m_states[i].m_token_id = state->m_token_id;
+
+            for (int c = 0; c < CHAR_MAX; ++c)
+            {
+                m_states[i].m_edge[c] = state->m_edge[c] ? location[state->m_edge[c]] : nullptr;
+            }
+        }
+
+        m_root = location[dfa.root];
+    }
+};
+
+struct compact_dfa
+{
+    static const uint16_t no_edge = UINT16_MAX;
+
+    std::vector<uint16_t> m_next;
+    std::vector<tokenize::token_id> m_token_ids;
+    uint16_t m_root = 0;
+
+    compact_dfa(const tokenize::dfa_base& dfa, const std::vector<size_t>& order)
+        : m_next(order.size() * 128, no_edge)
+        , m_token_ids(order.size())
+    {
+        std::unordered_map<const tokenize::dfa_state*, uint16_t> location;
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            location[dfa.states[order[i]]] = static_cast<uint16_t>(i);
+        }
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const tokenize::dfa_state* state = dfa.states[order[i]];
+            m_token_ids[i] = state->m_token_id;
+
+            for (int c = 0; c < CHAR_MAX; ++c)
+            {
+                if (state->m_edge[c])
+                {
+                    m_next[i * 128 + c] = location[state->m_edge[c]];
+                }
+            }
+        }
+
+        m_root = location[dfa.root];
+    }
+};
+
+// Each walker returns a checksum of the accepted token ids so the work cannot be optimized away.
+size_t walk(const tokenize::dfa_state* root, const char* stream)
+{
+    size_t checksum = 0;
+
+    while (*stream != '\0')
+    {
+        const tokenize::dfa_state* state = root;
+        size_t length = 0;
+
+        for (;;)
+        {
+            unsigned char c = static_cast<unsigned char>(stream[length]);
+            const tokenize::dfa_state* next = c < CHAR_MAX ? state->m_edge[c] : nullptr;
+
+            if (!next || c == '\0')
+            {
+                break;
+            }
+
+            state = next;
+            ++length;
+        }
+
+        checksum += static_cast<size_t>(state->m_token_id);
+        stream += std::max<size_t>(1, length);
+    }
+
+    return checksum;
+}
+
+size_t walk(const compact_dfa& dfa, const char* stream)
+{
+    size_t checksum = 0;
+
+    while (*stream != '\0')
+    {
+        uint16_t state = dfa.m_root;
+        size_t length = 0;
+
+        for (;;)
+        {
+            unsigned char c = static_cast<unsigned char>(stream[length]);
+            uint16_t next = c < CHAR_MAX ? dfa.m_next[state * 128u + c] : compact_dfa::no_edge;
+
+            if (next == compact_dfa::no_edge || c == '\0')
+            {
+                break;
+            }
+
+            state = next;
+            ++length;
+        }
+
+        checksum += static_cast<size_t>(dfa.m_token_ids[state]);
+        stream += std::max<size_t>(1, length);
+    }
+
+    return checksum;
+}
+
+void run(const char* name, const std::string& corpus, const std::function<size_t()>& lex)
+{
+    const int num_runs = 9;
+    double best_seconds = 1e30;
+    long long l1d_misses = -1;
+    long long last_level_misses = -1;
+    size_t checksum = 0;
+    cache_counter l1d(l1d_cache);
+    cache_counter last_level(last_level_cache);
+
+    for (int i = 0; i < num_runs; ++i)
+    {
+        l1d.start();
+        last_level.start();
+        auto start = std::chrono::steady_clock::now();
+        checksum += lex();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long l1d_count = l1d.stop();
+        long long last_level_count = last_level.stop();
+
+        if (seconds < best_seconds)
+        {
+            best_seconds = seconds;
+            l1d_misses = l1d_count;
+            last_level_misses = last_level_count;
+        }
+    }
+
+    double kilobytes = corpus.size() / 1024.0;
+    std::printf("%-24s %8.1f MB/s", name, corpus.size() / best_seconds / 1e6);
+
+    if (l1d_misses >= 0)
+    {
+        std::printf("  L1D misses/KB %8.2f", l1d_misses / kilobytes);
+    }
+    else
+    {
+        std::printf("  L1D misses/KB      n/a");
+    }
+
+    if (last_level_misses >= 0)
+    {
+        std::printf("  LLC misses/KB %8.3f", last_level_misses / kilobytes);
+    }
+    else
+    {
+        std::printf("  LLC misses/KB      n/a");
+    }
+
+    std::printf("  (checksum %zu)\n", checksum % 1000);
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::filesystem::path> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        paths.push_back(argv[i]);
+    }
+
+    if (paths.empty())
+    {
+        std::filesystem::path source_directory = TOKENIZE_SOURCE_DIRECTORY;
+        paths.push_back(source_directory / "tokenize" / "tokenize.hpp");
+        paths.push_back(source_directory / "tokenize" / "file_loader.hpp");
+        paths.push_back(source_directory / "tests" / "main.cpp");
+    }
+
+    std::string sample;
+
+    for (const std::filesystem::path& path : paths)
+    {
+        std::ifstream file(path, std::ifstream::in);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        sample += buffer.str();
+    }
+
+    if (sample.empty())
+    {
+        std::fprintf(stderr, "No input.\n");
+        return 1;
+    }
+
+    std::string corpus;
+
+    while (corpus.size() < (16u << 20))
+    {
+        corpus += sample;
+    }
+
+    tokenize::dfa_cpp dfa;
+    std::unordered_map<const tokenize::dfa_state*, size_t> index;
+    std::vector<size_t> build_order = state_indices(dfa, index);
+    std::vector<size_t> hot_order = profile_order(dfa, record_profile(dfa, sample));
+
+    packed_dfa packed(dfa, hot_order);
+    compact_dfa compact(dfa, build_order);
+    compact_dfa compact_hot(dfa, hot_order);
+
+    std::printf("dfa_cpp: %zu states, corpus %.1f MB\n", dfa.states.size(), corpus.size() / 1e6);
+    run("pointer, build order", corpus, [&]() { return walk(dfa.root, corpus.c_str()); });
+    run("pointer, profile order", corpus, [&]() { return walk(packed.m_root, corpus.c_str()); });
+    run("compact, build order", corpus, [&]() { return walk(compact, corpus.c_str()); });
+    run("compact, profile order", corpus, [&]() { return walk(compact_hot, corpus.c_str()); });
+    run("from_string (reference)", corpus, [&]()
+        {
+            tokenize::stream_context context;
+            tokenize::from_string(corpus, dfa, context);
+            return context.m_tokens.size();
+        });
+    return 0;
+}
@@ -1,8 +1,10 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <catch2/catch.hpp>
 #include <tokenize/tokenize.hpp>
+#include <tokenize/file_loader.hpp>
 #include <string>
 #include <filesystem>
+#include <fstream>
 
 TEST_CASE("Empty code string.")
 {
@@ -39,4 +41,250 @@ TEST_CASE("Tokenize non-existant-file")
     REQUIRE(context.m_num_lines == 1);
     REQUIRE(context.m_stream == "");
     REQUIRE(context.m_tokens.size() == 0);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Load multiple files.")
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "tokenize_from_files";
+    std::filesystem::create_directories(directory);
+
+    std::vector<std::filesystem::path> paths;
+    for (int i = 0; i < 16; ++i)
+    {
+        paths.push_back(directory / ("file" + std::to_string(i) + ".cpp"));
+        std::ofstream file(paths.back());
+        for (int j = 0; j <= i; ++j)
+        {
+            file << "int value" << j << " = " << j << ";\n";
+        }
+    }
+    paths.push_back(directory / "this-file-does-not-exist.cpp");
+
+    tokenize::dfa_cpp dfa;
+
+    bool io_uring_available = false;
+#if defined(TOKENIZE_HAS_IO_URING)
+    tokenize::internal::io_ring ring;
+    io_uring_available = ring.init(1);
+#endif
+
+    for (bool use_io_uring : { true, false })
+    {
+        tokenize::file_loader_options options;
+        options.m_max_reads_in_flight = 3;
+        options.m_use_io_uring = use_io_uring;
+
+        size_t num_callbacks = 0;
+        std::vector<tokenize::stream_context> contexts;
+        tokenize::file_loader_backend backend = tokenize::from_files(paths, dfa, contexts, options, [&](tokenize::stream_context&) { ++num_callbacks; });
+        REQUIRE(backend == (use_io_uring && io_uring_available ? tokenize::file_loader_backend::io_uring : tokenize::file_loader_backend::thread_pool));
+
+        REQUIRE(contexts.size() == paths.size());
+        REQUIRE(num_callbacks == paths.size());
+
+        std::vector<tokenize::stream_context> no_contexts;
+        REQUIRE(tokenize::from_files({}, dfa, no_contexts, options) == tokenize::file_loader_backend::none);
+
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            tokenize::stream_context expected;
+            tokenize::from_file(paths[i], dfa, expected);
+            REQUIRE(contexts[i].m_file_path == expected.m_file_path);
+            REQUIRE(contexts[i].m_stream == expected.m_stream);
+            REQUIRE(contexts[i].m_tokens.size() == expected.m_tokens.size());
+            REQUIRE(contexts[i].m_num_lines == expected.m_num_lines);
+        }
+    }
+
+    for (bool use_io_uring : { true, false })
+    {
+        tokenize::file_loader_options options;
+        options.m_max_reads_in_flight = 8;
+        options.m_use_io_uring = use_io_uring;
+
+        std::vector<tokenize::stream_context> contexts;
+        REQUIRE_THROWS_AS(tokenize::from_files(paths, dfa, contexts, options, [](tokenize::stream_context&) { throw tokenize::token_exception("stop"); }), tokenize::token_exception);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Token index.")
+{
+    std::string code = "#include <a>\nint a = b; { a = 1; } {}";
+    tokenize::dfa_cpp dfa;
+    tokenize::stream_context context;
+    context.m_options.m_index_token_kinds = true;
+    context.m_options.m_index_identifiers = true;
+    tokenize::from_string(code, dfa, context);
+
+    for (size_t kind = 0; kind < tokenize::token_id_count; ++kind)
+    {
+        tokenize::token_id id = static_cast<tokenize::token_id>(kind);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < context.m_tokens.size(); ++i)
+        {
+            if (context.m_tokens[i].m_id == id)
+            {
+                expected.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        tokenize::posting_list positions = context.m_token_index.find(id);
+        REQUIRE(std::vector<uint32_t>(positions.begin(), positions.end()) == expected);
+    }
+
+    REQUIRE(context.m_token_index.find(tokenize::token_id::include).size() == 1);
+    REQUIRE(context.m_token_index.find(tokenize::token_id::open_curly).size() == 2);
+    REQUIRE(context.m_token_index.find("a").size() == 3);
+    REQUIRE(context.m_token_index.find("b").size() == 1);
+    REQUIRE(context.m_token_index.find("c").empty());
+    REQUIRE(context.m_token_index.memory_usage() > 0);
+
+    tokenize::stream_context unindexed;
+    tokenize::from_string(code, dfa, unindexed);
+    REQUIRE(unindexed.m_token_index.find(tokenize::token_id::include).empty());
+    REQUIRE(unindexed.m_token_index.memory_usage() == 0);
+}
+
+TEST_CASE("Bracket matching.")
+{
+    std::string code = "void f(int a[2]) { if (a) { g({1, 2}); } } int x;";
+    tokenize::dfa_cpp dfa;
+
+    for (bool match_brackets : { true, false })
+    {
+        tokenize::parsing_context parser;
+        parser.m_token_context.m_options.m_match_brackets = match_brackets;
+        tokenize::from_string(code, dfa, parser.m_token_context);
+        REQUIRE(parser.m_token_context.m_bracket_table.empty() == !match_brackets);
+        REQUIRE(parser.m_token_context.m_bracket_table.balanced());
+
+        parser.set_current_token_index(0);
+        REQUIRE(parser.accept(tokenize::token_id::_void));
+        REQUIRE(parser.accept("f"));
+        REQUIRE(parser.skip_balanced());
+        REQUIRE(parser.get_current_token().m_id == tokenize::token_id::open_curly);
+        REQUIRE(parser.skip_balanced());
+        REQUIRE(parser.accept("int"));
+        REQUIRE(parser.accept("x"));
+        REQUIRE_FALSE(parser.skip_balanced());
+    }
+}
+
+TEST_CASE("Unbalanced brackets.")
+{
+    std::string code = "{ ( } ] [";
+    tokenize::dfa_cpp dfa;
+    tokenize::parsing_context parser;
+    parser.m_token_context.m_options.m_match_brackets = true;
+    tokenize::from_string(code, dfa, parser.m_token_context);
+
+    const tokenize::bracket_table& brackets = parser.m_token_context.m_bracket_table;
+    REQUIRE(brackets.partner(0) == 4);
+    REQUIRE(brackets.partner(4) == 0);
+    REQUIRE(brackets.m_unbalanced == std::vector<uint32_t>{ 2, 6, 8 });
+
+    parser.set_current_token_index(2);
+    REQUIRE_THROWS_AS(parser.skip_balanced(), tokenize::token_exception);
+}
+
+TEST_CASE("Literal decoding.")
+{
+    std::string code = "42 017 0x1F 0b101 2.5 1.5e3 0.25f 'a' '\\n' 99999999999999999999 ''' 1.0e999 09 1.0e-999 0.00001e-999 1.0e-50f 2345.5e305";
+    tokenize::dfa_cpp dfa;
+    tokenize::stream_context context;
+    context.m_options.m_decode_literals = true;
+    tokenize::from_string(code, dfa, context);
+
+    std::vector<const tokenize::literal_value*> values;
+    for (size_t i = 0; i < context.m_tokens.size(); ++i)
+    {
+        const tokenize::literal_value* value = context.m_literal_table.find(i);
+        REQUIRE((value == nullptr) == (context.m_tokens[i].m_id == tokenize::token_id::whitespace || context.m_tokens[i].m_id == tokenize::token_id::invalid || context.m_tokens[i].m_id == tokenize::token_id::identifier));
+        if (value)
+        {
+            values.push_back(value);
+        }
+    }
+
+    REQUIRE(values.size() == 17);
+    REQUIRE(values[0]->m_integer == 42);
+    REQUIRE(values[1]->m_integer == 15);
+    REQUIRE(values[2]->m_integer == 0x1F);
+    REQUIRE(values[3]->m_integer == 5);
+    REQUIRE(values[4]->m_float == 2.5);
+    REQUIRE(values[5]->m_float == 1500.0);
+    REQUIRE(values[6]->m_float == 0.25);
+    REQUIRE(values[7]->m_integer == 'a');
+    REQUIRE(values[8]->m_integer == '\n');
+
+    for (size_t i = 0; i < 9; ++i)
+    {
+        REQUIRE(values[i]->m_status == tokenize::literal_status::ok);
+    }
+
+    REQUIRE(values[9]->m_status == tokenize::literal_status::overflow);
+    REQUIRE(values[10]->m_status == tokenize::literal_status::malformed);
+    REQUIRE(values[11]->m_status == tokenize::literal_status::overflow);
+    REQUIRE(values[12]->m_status == tokenize::literal_status::malformed);
+    REQUIRE(values[13]->m_status == tokenize::literal_status::underflow);
+    REQUIRE(values[13]->m_float == 0.0);
+    REQUIRE(values[14]->m_status == tokenize::literal_status::underflow);
+    REQUIRE(values[15]->m_status == tokenize::literal_status::underflow);
+    REQUIRE(values[16]->m_status == tokenize::literal_status::overflow);
+
+    tokenize::stream_context undecoded;
+    tokenize::from_string(code, dfa, undecoded);
+    REQUIRE(undecoded.m_literal_table.m_values.empty());
+
+    tokenize::parsing_context parser;
+    parser.m_token_context.m_options.m_decode_literals = true;
+    tokenize::from_string(code, dfa, parser.m_token_context);
+    REQUIRE(!parser.m_token_context.m_literal_table.m_values.empty());
+    parser.remove_tokens(tokenize::token_id::whitespace);
+    REQUIRE(parser.m_token_context.m_literal_table.m_values.empty());
+}
+
+TEST_CASE("Token index after removing tokens.")
+{
+    tokenize::dfa_cpp dfa;
+    tokenize::parsing_context parser;
+    parser.m_token_context.m_options.m_index_token_kinds = true;
+    parser.m_token_context.m_options.m_index_identifiers = true;
+    tokenize::from_string("a b c { }", dfa, parser.m_token_context);
+    REQUIRE(parser.m_token_context.m_token_index.find(tokenize::token_id::closed_curly).size() == 1);
+
+    parser.remove_tokens(tokenize::token_id::whitespace);
+    REQUIRE(parser.m_token_context.m_token_index.find(tokenize::token_id::closed_curly).empty());
+    REQUIRE(parser.m_token_context.m_token_index.find("c").empty());
+
+    tokenize::from_string("a b c { }", dfa, parser.m_token_context);
+    parser.remove_identifier_tokens({ "a" });
+    REQUIRE(parser.m_token_context.m_token_index.find("b").empty());
+}
+
+TEST_CASE("Bracket matching after removing tokens.")
+{
+    std::string code = "A A A A ( x ) y";
+    tokenize::dfa_cpp dfa;
+    tokenize::parsing_context parser;
+    parser.m_token_context.m_options.m_match_brackets = true;
+    tokenize::from_string(code, dfa, parser.m_token_context);
+
+    parser.remove_identifier_tokens({ "A" });
+    parser.remove_tokens(tokenize::token_id::whitespace);
+    REQUIRE(parser.m_token_context.m_bracket_table.empty());
+
+    parser.set_current_token_index(0);
+    REQUIRE(parser.get_current_token().m_id == tokenize::token_id::open_parentheses);
+    REQUIRE(parser.skip_balanced());
+    REQUIRE(parser.accept("y"));
+
+    // A table that no longer matches the token vector is not used.
+    tokenize::from_string(code, dfa, parser.m_token_context);
+    parser.m_token_context.m_tokens.erase(parser.m_token_context.m_tokens.begin(), parser.m_token_context.m_tokens.begin() + 8);
+    parser.set_current_token_index(0);
+    REQUIRE(parser.skip_balanced());
+    REQUIRE(parser.accept("y"));
+}
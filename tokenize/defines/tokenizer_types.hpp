@@ -22,6 +22,8 @@ enum class token_id
 #include <tokenize/defines/tokens.inl>
 };
 
+static const size_t token_id_count = sizeof(token_text) / sizeof(token_text[0]);
+
 #undef TOKEN
 #define TOKEN(text, name) std::pair<std::string, token_id>( text, token_id::name),
 
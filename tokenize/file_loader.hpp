@@ -0,0 +1,586 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tokenize/tokenize.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TOKENIZE_HAS_PREAD 1
+#endif
+
+#if defined(__linux__) && !defined(TOKENIZE_DISABLE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define TOKENIZE_HAS_IO_URING 1
+#endif
+
+namespace tokenize
+{
+struct file_loader_options
+{
+  // Upper bound on reads that have been issued but whose buffers have not been tokenized yet.
+  size_t m_max_reads_in_flight = 32;
+
+  // Worker threads used by the pread fallback.
+  size_t m_num_threads = 4;
+
+  // Try io_uring first (Linux only). Falls back to the pread pool when the ring cannot be created.
+  bool m_use_io_uring = true;
+
+  // Copied into every stream_context before it is tokenized.
+  stream_options m_stream_options;
+};
+
+/*! The backend from_files used to read the files. */
+enum class file_loader_backend
+{
+  none,
+  io_uring,
+  thread_pool
+};
+
+typedef std::function<void(stream_context&)> stream_callback;
+
+namespace internal
+{
+static void begin_stream(const std::filesystem::path& file_path, const stream_options& options, stream_context& out_token_stream)
+{
+  out_token_stream.m_options = options;
+  out_token_stream.m_num_lines = 1;
+  out_token_stream.m_file_path = file_path.string();
+  out_token_stream.m_stream.clear();
+  out_token_stream.m_tokens.clear();
+}
+
+static void finish_stream(const dfa_base& dfa, stream_context& out_token_stream, const stream_callback& on_tokenized)
+{
+  tokenize_stream(dfa, out_token_stream);
+
+  if (on_tokenized)
+  {
+    on_tokenized(out_token_stream);
+  }
+}
+
+/*! Reads a whole file into a string. Missing or unreadable files produce an empty string, like from_file. */
+static void read_file(const std::filesystem::path& file_path, std::string& out_buffer)
+{
+  out_buffer.clear();
+
+#if defined(TOKENIZE_HAS_PREAD)
+  int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    return;
+  }
+
+  struct stat file_stat;
+
+  if (::fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0)
+  {
+    out_buffer.resize(static_cast<size_t>(file_stat.st_size));
+    size_t offset = 0;
+
+    while (offset < out_buffer.size())
+    {
+      ssize_t result = ::pread(fd, &out_buffer[offset], out_buffer.size() - offset, static_cast<off_t>(offset));
+
+      if (result < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (result <= 0)
+      {
+        break;
+      }
+
+      offset += static_cast<size_t>(result);
+    }
+
+    out_buffer.resize(offset);
+    ::close(fd);
+    return;
+  }
+
+  ::close(fd);
+#endif
+
+  std::ifstream file;
+  file.open(file_path, std::ifstream::in);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  out_buffer = buffer.str();
+}
+
+/*! Worker threads read files, the calling thread tokenizes them in completion order. */
+static void load_files_threaded(const std::vector<std::filesystem::path>& file_paths, const dfa_base& dfa, std::vector<stream_context>& out_token_streams, const file_loader_options& options, const stream_callback& on_tokenized)
+{
+  std::mutex mutex;
+  std::condition_variable slot_available;
+  std::condition_variable read_completed;
+  std::deque<size_t> completed;
+  size_t next_file = 0;
+  size_t in_flight = 0;
+  bool stop = false;
+
+  size_t max_in_flight = std::max<size_t>(1, options.m_max_reads_in_flight);
+  size_t num_threads = std::max<size_t>(1, std::min(options.m_num_threads, std::min(max_in_flight, file_paths.size())));
+
+  auto worker = [&]()
+  {
+    for (;;)
+    {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_available.wait(lock, [&]() { return stop || next_file >= file_paths.size() || in_flight < max_in_flight; });
+
+        if (stop || next_file >= file_paths.size())
+        {
+          return;
+        }
+
+        index = next_file++;
+        ++in_flight;
+      }
+
+      read_file(file_paths[index], out_token_streams[index].m_stream);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed.push_back(index);
+      }
+
+      read_completed.notify_one();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(num_threads);
+
+  for (size_t i = 0; i < num_threads; ++i)
+  {
+    workers.emplace_back(worker);
+  }
+
+  auto join_workers = [&]()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+
+    slot_available.notify_all();
+
+    for (std::thread& thread : workers)
+    {
+      thread.join();
+    }
+  };
+
+  try
+  {
+    for (size_t num_tokenized = 0; num_tokenized < file_paths.size(); ++num_tokenized)
+    {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        read_completed.wait(lock, [&]() { return !completed.empty(); });
+        index = completed.front();
+        completed.pop_front();
+      }
+
+      finish_stream(dfa, out_token_streams[index], on_tokenized);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --in_flight;
+      }
+
+      slot_available.notify_one();
+    }
+  }
+  catch (...)
+  {
+    join_workers();
+    throw;
+  }
+
+  join_workers();
+}
+
+#if defined(TOKENIZE_HAS_IO_URING)
+/*! Minimal io_uring wrapper over the raw system calls so that no liburing dependency is needed. */
+struct io_ring
+{
+  int m_fd = -1;
+
+  void* m_sq_ring = MAP_FAILED;
+  void* m_cq_ring = MAP_FAILED;
+  size_t m_sq_ring_size = 0;
+  size_t m_cq_ring_size = 0;
+  io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t m_sqes_size = 0;
+
+  unsigned* m_sq_tail = nullptr;
+  unsigned* m_sq_mask = nullptr;
+  unsigned* m_sq_array = nullptr;
+  unsigned* m_cq_head = nullptr;
+  unsigned* m_cq_tail = nullptr;
+  unsigned* m_cq_mask = nullptr;
+  io_uring_cqe* m_cqes = nullptr;
+
+  unsigned m_pending_submissions = 0;
+
+  ~io_ring()
+  {
+    if (m_sqes != MAP_FAILED)
+    {
+      ::munmap(m_sqes, m_sqes_size);
+    }
+
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+    {
+      ::munmap(m_cq_ring, m_cq_ring_size);
+    }
+
+    if (m_sq_ring != MAP_FAILED)
+    {
+      ::munmap(m_sq_ring, m_sq_ring_size);
+    }
+
+    if (m_fd >= 0)
+    {
+      ::close(m_fd);
+    }
+  }
+
+  bool init(unsigned entries)
+  {
+    io_uring_params params = {};
+    m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+
+    if (m_fd < 0)
+    {
+      return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+
+    m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+
+    if (m_sq_ring == MAP_FAILED)
+    {
+      return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      m_cq_ring = m_sq_ring;
+    }
+    else
+    {
+      m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+
+      if (m_cq_ring == MAP_FAILED)
+      {
+        return false;
+      }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+    if (m_sqes == MAP_FAILED)
+    {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(m_sq_ring);
+    char* cq = static_cast<char*>(m_cq_ring);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  /*! Queues a readv. The caller bounds the number of outstanding requests to the ring size. */
+  void queue_read(int fd, iovec* buffer, size_t offset, unsigned long long user_data)
+  {
+    unsigned tail = *m_sq_tail;
+    unsigned index = tail & *m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    *sqe = {};
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long long>(buffer);
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++m_pending_submissions;
+  }
+
+  /*! Submits queued reads and optionally blocks until at least one completion is available. */
+  bool submit(bool wait)
+  {
+    for (;;)
+    {
+      unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+      int result = static_cast<int>(::syscall(__NR_io_uring_enter, m_fd, m_pending_submissions, wait ? 1 : 0, flags, nullptr, 0));
+
+      if (result >= 0)
+      {
+        m_pending_submissions -= std::min<unsigned>(m_pending_submissions, static_cast<unsigned>(result));
+        return true;
+      }
+
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        return false;
+      }
+    }
+  }
+
+  bool pop_completion(unsigned long long& out_user_data, int& out_result)
+  {
+    unsigned head = *m_cq_head;
+
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+    {
+      return false;
+    }
+
+    const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+    out_user_data = cqe.user_data;
+    out_result = cqe.res;
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+};
+
+struct io_ring_read
+{
+  int m_fd = -1;
+  size_t m_index = 0;
+  size_t m_offset = 0;
+  iovec m_buffer = {};
+
+  io_ring_read() = default;
+  io_ring_read(const io_ring_read&) = delete;
+  io_ring_read& operator=(const io_ring_read&) = delete;
+
+  ~io_ring_read()
+  {
+    if (m_fd >= 0)
+    {
+      ::close(m_fd);
+    }
+  }
+};
+
+/*! Submits up to m_max_reads_in_flight reads through io_uring and tokenizes each buffer as soon as its read completes. */
+static bool load_files_io_uring(const std::vector<std::filesystem::path>& file_paths, const dfa_base& dfa, std::vector<stream_context>& out_token_streams, const file_loader_options& options, const stream_callback& on_tokenized)
+{
+  unsigned max_in_flight = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(options.m_max_reads_in_flight, 4096)));
+
+  // Declared before the ring so that the files outlive it.
+  std::vector<io_ring_read> reads(max_in_flight);
+  io_ring ring;
+
+  if (!ring.init(max_in_flight))
+  {
+    return false;
+  }
+
+  std::vector<unsigned> free_slots;
+  std::vector<size_t> ready;
+
+  for (unsigned i = max_in_flight; i > 0; --i)
+  {
+    free_slots.push_back(i - 1);
+  }
+
+  size_t next_file = 0;
+  unsigned in_flight = 0;
+
+  auto queue_remaining = [&](unsigned slot)
+  {
+    io_ring_read& read = reads[slot];
+    std::string& buffer = out_token_streams[read.m_index].m_stream;
+    read.m_buffer.iov_base = &buffer[read.m_offset];
+    read.m_buffer.iov_len = buffer.size() - read.m_offset;
+    ring.queue_read(read.m_fd, &read.m_buffer, read.m_offset, slot);
+  };
+
+  auto release = [&](unsigned slot)
+  {
+    ::close(reads[slot].m_fd);
+    reads[slot].m_fd = -1;
+    free_slots.push_back(slot);
+    --in_flight;
+  };
+
+  // Closing the ring only cancels outstanding reads asynchronously, and the buffers belong to the caller. So before
+  // an exception leaves this function, wait for every read still in flight to complete.
+  auto drain = [&]()
+  {
+    unsigned long long user_data;
+    int result;
+
+    while (in_flight > 0 && ring.submit(true))
+    {
+      while (ring.pop_completion(user_data, result))
+      {
+        release(static_cast<unsigned>(user_data));
+      }
+    }
+  };
+
+  try
+  {
+    while (next_file < file_paths.size() || in_flight > 0 || !ready.empty())
+    {
+      while (in_flight < max_in_flight && next_file < file_paths.size())
+      {
+        size_t index = next_file++;
+        stream_context& stream = out_token_streams[index];
+        int fd = ::open(file_paths[index].c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat file_stat;
+
+        if (fd < 0)
+        {
+          ready.push_back(index);
+          continue;
+        }
+
+        if (::fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0)
+        {
+          ::close(fd);
+          read_file(file_paths[index], stream.m_stream);
+          ready.push_back(index);
+          continue;
+        }
+
+        // Hand the file to its slot before allocating so that it is closed if the allocation throws.
+        unsigned slot = free_slots.back();
+        free_slots.pop_back();
+        reads[slot].m_fd = fd;
+        stream.m_stream.resize(static_cast<size_t>(file_stat.st_size));
+        reads[slot].m_index = index;
+        reads[slot].m_offset = 0;
+        ++in_flight;
+        queue_remaining(slot);
+      }
+
+      // Block only when there is nothing left to tokenize while the kernel works.
+      if (!ring.submit(ready.empty() && in_flight > 0))
+      {
+        throw token_exception("io_uring_enter failed.");
+      }
+
+      unsigned long long user_data;
+      int result;
+
+      while (ring.pop_completion(user_data, result))
+      {
+        unsigned slot = static_cast<unsigned>(user_data);
+        io_ring_read& read = reads[slot];
+        std::string& buffer = out_token_streams[read.m_index].m_stream;
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+          queue_remaining(slot);
+          continue;
+        }
+
+        if (result > 0)
+        {
+          read.m_offset += static_cast<size_t>(result);
+
+          if (read.m_offset < buffer.size())
+          {
+            queue_remaining(slot);
+            continue;
+          }
+        }
+
+        // Errors leave an empty stream like a missing file; a short read means the file shrank.
+        buffer.resize(result < 0 ? 0 : read.m_offset);
+        size_t index = read.m_index;
+        release(slot);
+        ready.push_back(index);
+      }
+
+      for (size_t index : ready)
+      {
+        finish_stream(dfa, out_token_streams[index], on_tokenized);
+      }
+
+      ready.clear();
+    }
+  }
+  catch (...)
+  {
+    drain();
+    throw;
+  }
+
+  return true;
+}
+#endif
+}
+
+/*! Loads and tokenizes a batch of files. Reads are issued asynchronously (io_uring on Linux, a pread thread pool
+    otherwise) and each buffer is tokenized on the calling thread as soon as its read completes, so lexing overlaps
+    with outstanding I/O. out_token_streams is resized to match file_paths and keeps its order; on_tokenized is called
+    in completion order. Returns the backend that was used (none when file_paths is empty). */
+static file_loader_backend from_files(const std::vector<std::filesystem::path>& file_paths, const dfa_base& dfa, std::vector<stream_context>& out_token_streams, const file_loader_options& options = file_loader_options(), const stream_callback& on_tokenized = nullptr)
+{
+  out_token_streams.clear();
+  out_token_streams.resize(file_paths.size());
+
+  for (size_t i = 0; i < file_paths.size(); ++i)
+  {
+    internal::begin_stream(file_paths[i], options.m_stream_options, out_token_streams[i]);
+  }
+
+  if (file_paths.empty())
+  {
+    return file_loader_backend::none;
+  }
+
+#if defined(TOKENIZE_HAS_IO_URING)
+  if (options.m_use_io_uring && internal::load_files_io_uring(file_paths, dfa, out_token_streams, options, on_tokenized))
+  {
+    return file_loader_backend::io_uring;
+  }
+#endif
+
+  internal::load_files_threaded(file_paths, dfa, out_token_streams, options, on_tokenized);
+  return file_loader_backend::thread_pool;
+}
+}
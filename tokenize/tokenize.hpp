@@ -1,7 +1,15 @@
 #pragma once
 
 #include <limits.h>
+#include <stdint.h>
+#include <charconv>
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <fstream>
 #include <sstream>
@@ -33,12 +41,191 @@ struct token_exception : public std::exception
   }
 };
 
+/*! Optional work done in the same pass as tokenization. Everything is off by default. */
+struct stream_options
+{
+  // Build token_index::find(token_id).
+  bool m_index_token_kinds = false;
+
+  // Build token_index::find(identifier). Keys point into stream_context::m_stream.
+  bool m_index_identifiers = false;
+
+  // Build bracket_table for (), [] and {}.
+  bool m_match_brackets = false;
+
+  // Decode integer, hex, binary, float and character literals into literal_table.
+  bool m_decode_literals = false;
+};
+
+/*! A sorted list of indices into stream_context::m_tokens. */
+struct posting_list
+{
+  const uint32_t* m_begin = nullptr;
+  const uint32_t* m_end = nullptr;
+
+  const uint32_t* begin() const { return m_begin; }
+  const uint32_t* end() const { return m_end; }
+  size_t size() const { return m_end - m_begin; }
+  bool empty() const { return m_begin == m_end; }
+  uint32_t operator[](size_t index) const { return m_begin[index]; }
+};
+
+/*! Token positions grouped by kind and by identifier text, built while tokenizing. It describes m_tokens as produced
+    by the tokenizer; parsing_context clears it when it removes tokens. */
+struct token_index
+{
+  // Positions of kind k are m_kind_positions[m_kind_offsets[k]] up to m_kind_positions[m_kind_offsets[k + 1]].
+  std::vector<uint32_t> m_kind_offsets;
+  std::vector<uint32_t> m_kind_positions;
+  std::unordered_map<std::string_view, std::vector<uint32_t>> m_identifier_positions;
+
+  void clear()
+  {
+    m_kind_offsets.clear();
+    m_kind_positions.clear();
+    m_identifier_positions.clear();
+  }
+
+  posting_list find(token_id id) const
+  {
+    size_t kind = static_cast<size_t>(id);
+
+    if (kind + 1 >= m_kind_offsets.size())
+    {
+      return posting_list();
+    }
+
+    const uint32_t* positions = m_kind_positions.data();
+    return posting_list{ positions + m_kind_offsets[kind], positions + m_kind_offsets[kind + 1] };
+  }
+
+  posting_list find(std::string_view identifier) const
+  {
+    auto it = m_identifier_positions.find(identifier);
+
+    if (it == m_identifier_positions.end())
+    {
+      return posting_list();
+    }
+
+    return posting_list{ it->second.data(), it->second.data() + it->second.size() };
+  }
+
+  /*! Approximate heap memory held by the index, in bytes. */
+  size_t memory_usage() const
+  {
+    size_t bytes = (m_kind_offsets.capacity() + m_kind_positions.capacity()) * sizeof(uint32_t);
+    if (!m_identifier_positions.empty())
+    {
+      bytes += m_identifier_positions.bucket_count() * sizeof(void*);
+    }
+
+    for (const auto& entry : m_identifier_positions)
+    {
+      bytes += sizeof(entry) + sizeof(void*) + entry.second.capacity() * sizeof(uint32_t);
+    }
+
+    return bytes;
+  }
+};
+
+/*! Matching partner of every bracket token, computed with a stack while tokenizing. It describes m_tokens as produced
+    by the tokenizer; parsing_context clears it when it removes tokens. */
+struct bracket_table
+{
+  static constexpr uint32_t no_partner = UINT32_MAX;
+
+  // One entry per token; no_partner for non-bracket tokens and for unbalanced brackets.
+  std::vector<uint32_t> m_partners;
+
+  // Sorted positions of brackets without a partner.
+  std::vector<uint32_t> m_unbalanced;
+
+  void clear()
+  {
+    m_partners.clear();
+    m_unbalanced.clear();
+  }
+
+  bool empty() const
+  {
+    return m_partners.empty();
+  }
+
+  uint32_t partner(size_t position) const
+  {
+    return position < m_partners.size() ? m_partners[position] : no_partner;
+  }
+
+  bool balanced() const
+  {
+    return m_unbalanced.empty();
+  }
+};
+
+enum class literal_status : uint8_t
+{
+  ok,
+  // Too large for uint64_t (integers) or double / float (float literals).
+  overflow,
+  // A non-zero float literal too small to represent; m_float is 0.
+  underflow,
+  malformed
+};
+
+/*! Decoded value of one literal token. Integer, hex, binary and character literals use m_integer, float literals use
+    m_float. */
+struct literal_value
+{
+  uint32_t m_token_index;
+  literal_status m_status;
+
+  union
+  {
+    uint64_t m_integer;
+    double m_float;
+  };
+};
+
+/*! Literal values decoded while tokenizing, sorted by token index. It describes m_tokens as produced by the tokenizer;
+    parsing_context clears it when it removes tokens. */
+struct literal_table
+{
+  std::vector<literal_value> m_values;
+
+  void clear()
+  {
+    m_values.clear();
+  }
+
+  /*! Returns the decoded literal for a token position, or nullptr if that token is not a decoded literal. */
+  const literal_value* find(size_t token_index) const
+  {
+    auto it = std::lower_bound(m_values.begin(), m_values.end(), token_index, [](const literal_value& value, size_t index)
+      {
+        return value.m_token_index < index;
+      });
+
+    if (it == m_values.end() || it->m_token_index != token_index)
+    {
+      return nullptr;
+    }
+
+    return &*it;
+  }
+};
+
 struct stream_context
 {
   std::string m_file_path;
   std::string m_stream;
   std::vector<token> m_tokens;
   size_t m_num_lines = 0;
+
+  stream_options m_options;
+  token_index m_token_index;
+  bracket_table m_bracket_table;
+  literal_table m_literal_table;
 };
 
 struct dfa_state
@@ -175,6 +362,68 @@ struct dfa_base
     }
   }
 
+  /*! If the current token opens a (), [] or {} region, moves past its closing partner and returns true. Uses
+      stream_context::m_bracket_table when it was built, otherwise counts brackets. */
+  bool skip_balanced(bool skip_whitespace_and_comments = true)
+  {
+    if (end_of_token_stream())
+    {
+      return false;
+    }
+
+    token_id open_id = get_current_token().m_id;
+    token_id close_id;
+
+    if (open_id == token_id::open_curly)
+    {
+      close_id = token_id::closed_curly;
+    }
+    else if (open_id == token_id::open_parentheses)
+    {
+      close_id = token_id::closed_parentheses;
+    }
+    else if (open_id == token_id::open_bracket)
+    {
+      close_id = token_id::closed_bracket;
+    }
+    else
+    {
+      return false;
+    }
+
+    const bracket_table& brackets = m_token_context.m_bracket_table;
+
+    // The table is only trusted while it still lines up with the token vector.
+    if (!brackets.empty() && brackets.m_partners.size() == m_token_context.m_tokens.size())
+    {
+      uint32_t partner = brackets.partner(m_current_token);
+      expect(partner != bracket_table::no_partner, "Unbalanced '" + token_text[static_cast<size_t>(open_id)] + "'.");
+      m_current_token = static_cast<int>(partner);
+      advance_token_stream(skip_whitespace_and_comments);
+      return true;
+    }
+
+    int depth = 0;
+
+    for (size_t i = static_cast<size_t>(m_current_token); i < m_token_context.m_tokens.size(); ++i)
+    {
+      token_id id = m_token_context.m_tokens[i].m_id;
+
+      if (id == open_id)
+      {
+        ++depth;
+      }
+      else if (id == close_id && --depth == 0)
+      {
+        m_current_token = static_cast<int>(i);
+        advance_token_stream(skip_whitespace_and_comments);
+        return true;
+      }
+    }
+
+    return expect(false, "Unbalanced '" + token_text[static_cast<size_t>(open_id)] + "'.");
+  }
+
   bool accept(const std::string& identifier, bool skip_whitespace_and_comments = true)
   {
     expect(!end_of_token_stream(), "Unexpected end of stream.");
@@ -270,6 +519,7 @@ struct dfa_base
 
     m_token_context.m_tokens.erase(m_token_context.m_tokens.begin() + start_index, m_token_context.m_tokens.begin() + end_index);
     m_current_token -= (end_index - start_index);
+    clear_token_tables();
   }
 
   void remove_tokens(token_id id)
@@ -285,6 +535,15 @@ struct dfa_base
     }
 
     m_token_context.m_tokens = new_list;
+    clear_token_tables();
+  }
+
+  /*! Drops side tables that hold token positions, which no longer line up once tokens are removed. */
+  void clear_token_tables()
+  {
+    m_token_context.m_token_index.clear();
+    m_token_context.m_bracket_table.clear();
+    m_token_context.m_literal_table.clear();
   }
 
 };
@@ -447,7 +706,8 @@ static void read_token(const char* stream, const dfa_base& dfa, token& out_token
   }
 }
 
-static void read_language_token(const char* stream, const dfa_base& dfa, stream_context& out_token_stream, token& out_token)
+/*! Reads one token and gives a trailing '.' back to the stream, so "1." lexes as an integer and a member access. */
+static void read_trimmed_token(const char* stream, const dfa_base& dfa, token& out_token)
 {
   read_token(stream, dfa, out_token);
 
@@ -456,6 +716,11 @@ static void read_language_token(const char* stream, const dfa_base& dfa, stream_
     out_token.m_id = token_id::integer_literal;
     out_token.m_length -= 1;
   }
+}
+
+static void read_language_token(const char* stream, const dfa_base& dfa, stream_context& out_token_stream, token& out_token)
+{
+  read_trimmed_token(stream, dfa, out_token);
 
   out_token.m_line_number = out_token_stream.m_num_lines;
 
@@ -477,8 +742,369 @@ static void read_language_token(const char* stream, const dfa_base& dfa, stream_
   }
 }
 
+/*! Collects per-kind positions while tokenizing, then packs them into token_index. */
+struct token_index_builder
+{
+  token_index& m_index;
+  const stream_options& m_options;
+  std::vector<std::vector<uint32_t>> m_kind_positions;
+
+  token_index_builder(token_index& index, const stream_options& options)
+    : m_index(index)
+    , m_options(options)
+  {
+    m_index.clear();
+
+    if (m_options.m_index_token_kinds)
+    {
+      m_kind_positions.resize(token_id_count);
+    }
+  }
+
+  bool enabled() const
+  {
+    return m_options.m_index_token_kinds || m_options.m_index_identifiers;
+  }
+
+  void add(const token& language_token, uint32_t position)
+  {
+    if (m_options.m_index_token_kinds)
+    {
+      m_kind_positions[static_cast<size_t>(language_token.m_id)].push_back(position);
+    }
+
+    if (m_options.m_index_identifiers && language_token.m_id == token_id::identifier)
+    {
+      m_index.m_identifier_positions[std::string_view(language_token.m_stream, language_token.m_length)].push_back(position);
+    }
+  }
+
+  void finish()
+  {
+    if (!m_options.m_index_token_kinds)
+    {
+      return;
+    }
+
+    size_t num_positions = 0;
+
+    for (const auto& positions : m_kind_positions)
+    {
+      num_positions += positions.size();
+    }
+
+    m_index.m_kind_offsets.reserve(token_id_count + 1);
+    m_index.m_kind_positions.reserve(num_positions);
+    m_index.m_kind_offsets.push_back(0);
+
+    for (const auto& positions : m_kind_positions)
+    {
+      m_index.m_kind_positions.insert(m_index.m_kind_positions.end(), positions.begin(), positions.end());
+      m_index.m_kind_offsets.push_back(static_cast<uint32_t>(m_index.m_kind_positions.size()));
+    }
+  }
+};
+
+/*! Pairs brackets with a stack. A closing bracket that does not match the top of the stack is paired with the nearest
+    open bracket of its kind (everything opened after it is unbalanced), or is itself unbalanced if there is none. */
+struct bracket_table_builder
+{
+  bracket_table& m_table;
+  std::vector<uint32_t> m_open;
+
+  bracket_table_builder(bracket_table& table)
+    : m_table(table)
+  {
+    m_table.clear();
+  }
+
+  static token_id opening_bracket(token_id id)
+  {
+    switch (id)
+    {
+    case token_id::closed_curly: return token_id::open_curly;
+    case token_id::closed_parentheses: return token_id::open_parentheses;
+    case token_id::closed_bracket: return token_id::open_bracket;
+    default: return token_id::invalid;
+    }
+  }
+
+  void add(token_id id, const std::vector<token>& tokens)
+  {
+    uint32_t position = static_cast<uint32_t>(m_table.m_partners.size());
+    m_table.m_partners.push_back(bracket_table::no_partner);
+
+    if (id == token_id::open_curly || id == token_id::open_parentheses || id == token_id::open_bracket)
+    {
+      m_open.push_back(position);
+      return;
+    }
+
+    token_id open_id = opening_bracket(id);
+
+    if (open_id == token_id::invalid)
+    {
+      return;
+    }
+
+    size_t depth = m_open.size();
+
+    while (depth > 0 && tokens[m_open[depth - 1]].m_id != open_id)
+    {
+      --depth;
+    }
+
+    if (depth == 0)
+    {
+      m_table.m_unbalanced.push_back(position);
+      return;
+    }
+
+    m_table.m_unbalanced.insert(m_table.m_unbalanced.end(), m_open.begin() + depth, m_open.end());
+    m_open.resize(depth);
+
+    uint32_t partner = m_open.back();
+    m_open.pop_back();
+    m_table.m_partners[partner] = position;
+    m_table.m_partners[position] = partner;
+  }
+
+  void finish()
+  {
+    m_table.m_unbalanced.insert(m_table.m_unbalanced.end(), m_open.begin(), m_open.end());
+    std::sort(m_table.m_unbalanced.begin(), m_table.m_unbalanced.end());
+  }
+};
+
+static literal_status decode_integer(const char* begin, const char* end, int base, uint64_t& out_value)
+{
+  out_value = 0;
+  std::from_chars_result result = std::from_chars(begin, end, out_value, base);
+
+  if (result.ec == std::errc::result_out_of_range)
+  {
+    return literal_status::overflow;
+  }
+
+  return result.ec == std::errc() && result.ptr == end ? literal_status::ok : literal_status::malformed;
+}
+
+#if defined(__cpp_lib_to_chars) && !defined(TOKENIZE_DISABLE_FLOAT_FROM_CHARS)
+/*! Tells overflow from underflow for a float literal that from_chars rejected as out of range, from the decimal
+    exponent of its leading significant digit. */
+static literal_status float_range_error(const char* begin, const char* end)
+{
+  const char* exponent = std::find(begin, end, 'e');
+  const char* point = std::find(begin, exponent, '.');
+  const char* first = std::find_if(begin, exponent, [](char c) { return c != '0' && c != '.'; });
+
+  if (first == exponent)
+  {
+    return literal_status::underflow;
+  }
+
+  long long magnitude = first < point ? point - first - 1 : -(first - point);
+  long long exponent_value = 0;
+
+  if (exponent != end)
+  {
+    const char* digits = exponent + 1;
+    bool negative = digits != end && *digits == '-';
+
+    if (digits != end && (*digits == '-' || *digits == '+'))
+    {
+      ++digits;
+    }
+
+    if (std::from_chars(digits, end, exponent_value).ec != std::errc())
+    {
+      exponent_value = LLONG_MAX / 2;
+    }
+
+    exponent_value = negative ? -exponent_value : exponent_value;
+  }
+
+  return magnitude + exponent_value > 0 ? literal_status::overflow : literal_status::underflow;
+}
+#endif
+
+/*! Parses a double with std::from_chars where the standard library supports it for floating point (libc++ before
+    LLVM 20, including Apple clang, does not), otherwise with strtod. Define TOKENIZE_DISABLE_FLOAT_FROM_CHARS to
+    force the strtod path. */
+static literal_status parse_double(const char* begin, const char* end, double& out_value)
+{
+#if defined(__cpp_lib_to_chars) && !defined(TOKENIZE_DISABLE_FLOAT_FROM_CHARS)
+  std::from_chars_result result = std::from_chars(begin, end, out_value);
+
+  if (result.ec == std::errc::result_out_of_range)
+  {
+    out_value = 0.0;
+    return float_range_error(begin, end);
+  }
+
+  if (result.ec != std::errc() || result.ptr != end)
+  {
+    return literal_status::malformed;
+  }
+
+  return literal_status::ok;
+#else
+  // strtod needs a terminated string and reads the decimal point from the current locale.
+  std::string text(begin, end);
+  const char* decimal_point = std::localeconv()->decimal_point;
+
+  if (decimal_point && decimal_point[0] != '\0' && decimal_point[0] != '.')
+  {
+    std::replace(text.begin(), text.end(), '.', decimal_point[0]);
+  }
+
+  char* parsed_end = nullptr;
+  errno = 0;
+  double value = std::strtod(text.c_str(), &parsed_end);
+
+  if (text.empty() || parsed_end != text.c_str() + text.size())
+  {
+    return literal_status::malformed;
+  }
+
+  if (errno == ERANGE)
+  {
+    if (std::isinf(value))
+    {
+      return literal_status::overflow;
+    }
+
+    if (value == 0.0)
+    {
+      return literal_status::underflow;
+    }
+  }
+
+  out_value = value;
+  return literal_status::ok;
+#endif
+}
+
+static literal_status decode_float(const char* begin, const char* end, double& out_value)
+{
+  out_value = 0.0;
+  bool single_precision = end > begin && end[-1] == 'f';
+
+  if (single_precision)
+  {
+    --end;
+  }
+
+  literal_status status = parse_double(begin, end, out_value);
+
+  if (status != literal_status::ok)
+  {
+    return status;
+  }
+
+  if (single_precision)
+  {
+    bool non_zero = out_value != 0.0;
+    out_value = static_cast<float>(out_value);
+
+    if (std::isinf(out_value))
+    {
+      return literal_status::overflow;
+    }
+
+    if (non_zero && out_value == 0.0)
+    {
+      return literal_status::underflow;
+    }
+  }
+
+  return literal_status::ok;
+}
+
+static literal_status decode_character(const char* begin, const char* end, uint64_t& out_value)
+{
+  out_value = 0;
+
+  // Strip the quotes.
+  ++begin;
+  --end;
+
+  if (end - begin == 1 && *begin != '\\' && *begin != '\'')
+  {
+    out_value = static_cast<unsigned char>(*begin);
+    return literal_status::ok;
+  }
+
+  if (end - begin != 2 || *begin != '\\')
+  {
+    return literal_status::malformed;
+  }
+
+  switch (begin[1])
+  {
+  case 'n': out_value = '\n'; break;
+  case 'r': out_value = '\r'; break;
+  case 't': out_value = '\t'; break;
+  case 'v': out_value = '\v'; break;
+  case 'a': out_value = '\a'; break;
+  case 'b': out_value = '\b'; break;
+  case 'f': out_value = '\f'; break;
+  case '0': out_value = '\0'; break;
+  case '\\': out_value = '\\'; break;
+  case '\'': out_value = '\''; break;
+  case '"': out_value = '"'; break;
+  case '?': out_value = '?'; break;
+  default: return literal_status::malformed;
+  }
+
+  return literal_status::ok;
+}
+
+/*! Decodes a literal token into out_table. Returns false for tokens that are not decoded literals. */
+static bool decode_literal(const token& language_token, uint32_t token_index, literal_table& out_table)
+{
+  const char* begin = language_token.m_stream;
+  const char* end = begin + language_token.m_length;
+  literal_value value;
+  value.m_token_index = token_index;
+
+  switch (language_token.m_id)
+  {
+  case token_id::integer_literal:
+    // A leading zero makes the literal octal, as in C++.
+    value.m_status = language_token.m_length > 1 && *begin == '0' ? decode_integer(begin + 1, end, 8, value.m_integer) : decode_integer(begin, end, 10, value.m_integer);
+    break;
+  case token_id::hex_literal:
+    value.m_status = decode_integer(begin + 2, end, 16, value.m_integer);
+    break;
+  case token_id::binary_literal:
+    value.m_status = decode_integer(begin + 2, end, 2, value.m_integer);
+    break;
+  case token_id::float_literal:
+    value.m_status = decode_float(begin, end, value.m_float);
+    break;
+  case token_id::character_literal:
+    value.m_status = decode_character(begin, end, value.m_integer);
+    break;
+  default:
+    return false;
+  }
+
+  out_table.m_values.push_back(value);
+  return true;
+}
+
 static void tokenize_stream(const dfa_base& dfa, stream_context& out_token_stream)
 {
+  token_index_builder index_builder(out_token_stream.m_token_index, out_token_stream.m_options);
+  bool build_index = index_builder.enabled();
+
+  bracket_table_builder bracket_builder(out_token_stream.m_bracket_table);
+  bool match_brackets = out_token_stream.m_options.m_match_brackets;
+
+  bool decode_literals = out_token_stream.m_options.m_decode_literals;
+  out_token_stream.m_literal_table.clear();
+
   const char* stream = out_token_stream.m_stream.c_str();
   while (*stream != '\0')
   {
@@ -492,9 +1118,31 @@ static void tokenize_stream(const dfa_base& dfa, stream_context& out_token_strea
     }
     else
     {
+      if (build_index)
+      {
+        index_builder.add(language_token, static_cast<uint32_t>(out_token_stream.m_tokens.size()));
+      }
+
       out_token_stream.m_tokens.push_back(language_token);
+
+      if (match_brackets)
+      {
+        bracket_builder.add(language_token.m_id, out_token_stream.m_tokens);
+      }
+
+      if (decode_literals)
+      {
+        decode_literal(language_token, static_cast<uint32_t>(out_token_stream.m_tokens.size() - 1), out_token_stream.m_literal_table);
+      }
     }
   }
+
+  index_builder.finish();
+
+  if (match_brackets)
+  {
+    bracket_builder.finish();
+  }
 }
 
 }